@@ -25,8 +25,20 @@
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
+#define RCVBUFFER 0     /* 1 = B keeps out-of-order packets instead of discarding them */
+#if RCVBUFFER
+#define SEQSPACE (2*WINDOWSIZE)  /* buffering at B needs the same sequence space as SR to tell old packets from new */
+#else
 #define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
+#endif
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define DUPACKTHRESH 3  /* duplicate ACKs that trigger a fast retransmit, 0 disables it */
+#define GOBACKBURST 2   /* packets resent at once when going back, WINDOWSIZE resends the whole window */
+#define SENDNAK RCVBUFFER  /* 1 = B sends a NAK naming the missing packets as soon as it sees a gap.
+                             Needs RCVBUFFER, with SEQSPACE 7 B cannot tell a gap from an old duplicate */
+#if SENDNAK && !RCVBUFFER
+#error "SENDNAK needs RCVBUFFER"
+#endif
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
@@ -54,6 +66,19 @@ bool IsCorrupted(struct pkt packet)
     return (true);
 }
 
+/* position of seqnum in a window starting at seqbase */
+int WindowIndex(int seqnum, int seqbase)
+{
+  return (seqnum - seqbase + SEQSPACE) % SEQSPACE;
+}
+
+/* a NAK from B has its payload filled with 'N's instead of the '0's of an ACK.
+   seqnum and acknum hold the first and last missing sequence numbers */
+bool IsNak(struct pkt packet)
+{
+  return (packet.payload[0] == 'N');
+}
+
 
 /********* Sender (A) variables and functions ************/
 
@@ -61,6 +86,33 @@ static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for
 static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
 static int windowcount;                /* the number of packets currently awaiting an ACK */
 static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+static int dupACKcount;                /* the number of duplicate ACKs seen since the last new ACK */
+static int resendnext, resendend;      /* window offsets of the next packet to resend and the end of the go back */
+
+/* resend up to count packets of the current go back, starting from resendnext */
+static void ResendPackets(int count)
+{
+  while (count > 0 && resendnext < resendend) {
+
+    if (TRACE > 0)
+      printf ("---A: resending packet %d\n", (buffer[(windowfirst+resendnext) % WINDOWSIZE]).seqnum);
+
+    tolayer3(A,buffer[(windowfirst+resendnext) % WINDOWSIZE]);
+    packets_resent++;
+    resendnext++;
+    count--;
+  }
+}
+
+/* go back N: start resending the packets awaiting an ACK from the window base.
+   Only the first GOBACKBURST go out now, the rest are clocked out by the ACKs that come back.
+*/
+static void GoBack(void)
+{
+  resendnext = 0;
+  resendend = windowcount;
+  ResendPackets(GOBACKBURST);
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
 void A_output(struct msg message)
@@ -108,15 +160,44 @@ void A_output(struct msg message)
 
 
 /* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
+   In this practical this will always be an ACK or a NAK as B never sends data.
 */
 void A_input(struct pkt packet)
 {
   int ackcount = 0;
   int i;
+  int first, last;
+
+  /* if received NAK is not corrupted, resend what B is missing */
+  if (!IsCorrupted(packet) && IsNak(packet)) {
+    if (TRACE > 0)
+      printf("----A: uncorrupted NAK %d-%d is received\n", packet.seqnum, packet.acknum);
+
+    /* window offsets of the missing packets, ignore a NAK for packets no longer in the window */
+    if (windowcount != 0) {
+      first = WindowIndex(packet.seqnum, buffer[windowfirst].seqnum);
+      last = WindowIndex(packet.acknum, buffer[windowfirst].seqnum);
+      if (first < windowcount) {
+        /* B holds everything after the gap, resend exactly the missing packets */
+        for (i=first; i<=last && i<windowcount; i++) {
+          if (TRACE > 0)
+            printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+          tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
+          packets_resent++;
+        }
 
+        /* the base was resent: restart its timer and stop the duplicate ACKs
+           for this gap from triggering another retransmit */
+        if (first == 0) {
+          dupACKcount = DUPACKTHRESH;
+          stoptimer(A);
+          starttimer(A, RTT);
+        }
+      }
+    }
+  }
   /* if received ACK is not corrupted */
-  if (!IsCorrupted(packet)) {
+  else if (!IsCorrupted(packet)) {
     if (TRACE > 0)
       printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
     total_ACKs_received++;
@@ -133,12 +214,10 @@ void A_input(struct pkt packet)
             if (TRACE > 0)
               printf("----A: ACK %d is not a duplicate\n",packet.acknum);
             new_ACKs++;
+            dupACKcount = 0;
 
             /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
-            else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
+            ackcount = WindowIndex(packet.acknum, seqfirst) + 1;
 
 	    /* slide window by the number of packets ACKed */
             windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
@@ -147,12 +226,33 @@ void A_input(struct pkt packet)
             for (i=0; i<ackcount; i++)
               windowcount--;
 
+            /* packets covered by this ACK no longer need resending. While going back,
+               resend two packets for each one ACKed so the burst grows like slow start */
+            resendnext = (resendnext > ackcount) ? resendnext - ackcount : 0;
+            resendend = (resendend > ackcount) ? resendend - ackcount : 0;
+            ResendPackets(2 * ackcount);
+
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
             if (windowcount > 0)
               starttimer(A, RTT);
 
           }
+          else {
+            /* duplicate ACK for the packet before the window base */
+            dupACKcount++;
+            if (TRACE > 0)
+              printf ("----A: duplicate ACK %d received (%d in a row)\n", packet.acknum, dupACKcount);
+
+            /* only go back once per loss, further duplicates wait for a new ACK or the timeout */
+            if (DUPACKTHRESH > 0 && dupACKcount == DUPACKTHRESH) {
+              if (TRACE > 0)
+                printf("----A: fast retransmit, resend packets!\n");
+              GoBack();
+              stoptimer(A);
+              starttimer(A, RTT);
+            }
+          }
         }
         else
           if (TRACE > 0)
@@ -166,20 +266,13 @@ void A_input(struct pkt packet)
 /* called when A's timer goes off */
 void A_timerinterrupt(void)
 {
-  int i;
-
   if (TRACE > 0)
     printf("----A: time out,resend packets!\n");
 
-  for(i=0; i<windowcount; i++) {
-
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
-
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
-  }
+  dupACKcount = 0;
+  GoBack();
+  if (windowcount > 0)
+    starttimer(A,RTT);
 }
 
 
@@ -196,6 +289,9 @@ void A_init(void)
 		     so initially this is set to -1
 		   */
   windowcount = 0;
+  dupACKcount = 0;
+  resendnext = 0;
+  resendend = 0;
 }
 
 
@@ -204,6 +300,37 @@ void A_init(void)
 
 static int expectedseqnum; /* the sequence number expected next by the receiver */
 static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static struct pkt buffer_b[WINDOWSIZE];  /* out-of-order packets held by B, indexed by seqnum % WINDOWSIZE */
+static bool received[WINDOWSIZE];        /* true if the matching buffer_b slot holds a packet */
+static int lastnak;                      /* expectedseqnum when the last NAK was sent, NOTINUSE if none */
+
+/* tell A which packets are missing, once per gap, when a packet arrives ahead of expectedseqnum */
+static void SendNak(int seqnum)
+{
+  struct pkt nakpkt;
+  int last;
+  int i;
+
+  if (!SENDNAK || lastnak == expectedseqnum)
+    return;
+
+  /* the gap ends before the packet just received or the first packet already buffered */
+  last = expectedseqnum;
+  while ((last + 1) % SEQSPACE != seqnum && !received[((last + 1) % SEQSPACE) % WINDOWSIZE])
+    last = (last + 1) % SEQSPACE;
+
+  if (TRACE > 0)
+    printf("----B: gap detected, send NAK %d-%d!\n", expectedseqnum, last);
+
+  nakpkt.seqnum = expectedseqnum;
+  nakpkt.acknum = last;
+  for ( i=0; i<20 ; i++ )
+    nakpkt.payload[i] = 'N';
+  nakpkt.checksum = ComputeChecksum(nakpkt);
+  tolayer3 (B, nakpkt);
+
+  lastnak = expectedseqnum;
+}
 
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
@@ -211,6 +338,7 @@ void B_input(struct pkt packet)
 {
   struct pkt sendpkt;
   int i;
+  int slot;
 
   /* if not corrupted and received packet is in order */
   if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
@@ -226,6 +354,40 @@ void B_input(struct pkt packet)
 
     /* update state variables */
     expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    lastnak = NOTINUSE;
+
+    /* the gap is filled, deliver the packets buffered behind it and ACK the last one */
+    while (RCVBUFFER && received[expectedseqnum % WINDOWSIZE]) {
+      slot = expectedseqnum % WINDOWSIZE;
+      if (TRACE > 0)
+        printf("----B: delivering buffered packet %d\n", expectedseqnum);
+      tolayer5(B, buffer_b[slot].payload);
+      received[slot] = false;
+      sendpkt.acknum = expectedseqnum;
+      expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    }
+  }
+  else if ( RCVBUFFER && (!IsCorrupted(packet)) &&
+            ((packet.seqnum - expectedseqnum + SEQSPACE) % SEQSPACE) < WINDOWSIZE ) {
+    /* packet is ahead of a gap but inside the receive window, hold it until the gap fills */
+    slot = packet.seqnum % WINDOWSIZE;
+    if (!received[slot]) {
+      if (TRACE > 0)
+        printf("----B: packet %d is out of order, buffer it and resend ACK!\n", packet.seqnum);
+      packets_received++;
+      SendNak(packet.seqnum);
+      buffer_b[slot] = packet;
+      received[slot] = true;
+    }
+    else
+      if (TRACE > 0)
+        printf("----B: packet %d is already buffered, resend ACK!\n", packet.seqnum);
+
+    /* acknowledge cumulatively, the sender still needs the missing packet */
+    if (expectedseqnum == 0)
+      sendpkt.acknum = SEQSPACE - 1;
+    else
+      sendpkt.acknum = expectedseqnum - 1;
   }
   else {
     /* packet is corrupted or out of order resend last ACK */
@@ -256,8 +418,13 @@ void B_input(struct pkt packet)
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
+  int i;
+
   expectedseqnum = 0;
   B_nextseqnum = 1;
+  lastnak = NOTINUSE;
+  for (i=0; i<WINDOWSIZE; i++)
+    received[i] = false;
 }
 
 /******************************************************************************
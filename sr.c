@@ -28,6 +28,7 @@
                           MUST BE SET TO 6 when submitting assignment */
 #define SEQSPACE (2*WINDOWSIZE)      /* The serial number space of the SR is at least twice the size of the window, otherwise it is impossible to distinguish between old and new packages. */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define SENDNAK 1       /* 1 = B sends a NAK naming the missing packets as soon as it sees a gap */
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
@@ -55,6 +56,19 @@ bool IsCorrupted(struct pkt packet)
     return (true);
 }
 
+/* position of seqnum in a window starting at seqbase, used for both A's and B's buffer */
+int WindowIndex(int seqnum, int seqbase)
+{
+  return (seqnum - seqbase + SEQSPACE) % SEQSPACE;
+}
+
+/* a NAK from B has its payload filled with 'N's instead of the '0's of an ACK.
+   seqnum and acknum hold the first and last missing sequence numbers */
+bool IsNak(struct pkt packet)
+{
+  return (packet.payload[0] == 'N');
+}
+
 
 /********* Sender (A) variables and functions ************/
 
@@ -97,10 +111,7 @@ void A_output(struct msg message)
 
     /* put packet in window buffer */
     /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    if (A_nextseqnum >= seqfirst)
-      index = A_nextseqnum - seqfirst;
-    else
-      index = WINDOWSIZE - seqfirst + A_nextseqnum;
+    index = WindowIndex(A_nextseqnum, seqfirst);
     buffer[index] = sendpkt;
     windowcount++;
 
@@ -126,16 +137,45 @@ void A_output(struct msg message)
 
 
 /* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
+   In this practical this will always be an ACK or a NAK as B never sends data.
 */
 void A_input(struct pkt packet)
 {
   int i, ack_shift = 0;
   int rel_index, seq_base, seq_end;
   int in_window;
+  int first, last, sent;
 
+  /* if received NAK is not corrupted, resend the missing packets that are still unacked */
+  if (IsCorrupted(packet) == false && IsNak(packet))
+  {
+    if (TRACE > 0)
+      printf("----A: uncorrupted NAK %d-%d is received\n", packet.seqnum, packet.acknum);
+
+    /* window offsets of the missing packets, a NAK for packets no longer in the window sends nothing */
+    sent = WindowIndex(A_nextseqnum, seq_a);
+    first = WindowIndex(packet.seqnum, seq_a);
+    last = WindowIndex(packet.acknum, seq_a);
+    for (i = first; i <= last && i < sent; ++i)
+    {
+      if (buffer[i].acknum == NOTINUSE)
+      {
+        if (TRACE > 0)
+          printf("---A: resending packet %d\n", buffer[i].seqnum);
+        tolayer3(A, buffer[i]);
+        packets_resent++;
+      }
+    }
+
+    /* the base was resent, restart its timer */
+    if (first == 0 && windowcount > 0)
+    {
+      stoptimer(A);
+      starttimer(A, RTT);
+    }
+  }
   /* if received ACK is not corrupted */
-  if (IsCorrupted(packet) == false)
+  else if (IsCorrupted(packet) == false)
   {
     if (TRACE > 0)
       printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
@@ -152,9 +192,7 @@ void A_input(struct pkt packet)
     if (in_window)
     {
       /* calculate relative index in circular buffer */
-      rel_index = (packet.acknum >= seq_base)
-                      ? packet.acknum - seq_base
-                      : WINDOWSIZE - (seq_base - packet.acknum);
+      rel_index = WindowIndex(packet.acknum, seq_base);
 
       /* new ACK */
       if (buffer[rel_index].acknum == NOTINUSE)
@@ -244,9 +282,40 @@ void A_init(void)
 
 /********* Receiver (B)  variables and procedures ************/
 
-static struct pkt buffer_b[WINDOWSIZE];    
+static struct pkt buffer_b[WINDOWSIZE];  /* packets held by B, acknum is NOTINUSE for an empty slot */
 static int seq_b;        
-static int receivelast; 
+static int lastnak;     /* seq_b when the last NAK was sent, NOTINUSE if none */
+
+/* tell A which packets are missing, once per gap, when packet index of the window arrives before the base */
+static void SendNak(int index)
+{
+  struct pkt nakpkt;
+  int i;
+
+  if (!SENDNAK || lastnak == seq_b)
+    return;
+
+  /* the gap runs from the base up to the first packet already buffered */
+  for (i = 0; i < index; i++)
+  {
+    if (buffer_b[i].acknum != NOTINUSE)
+      break;
+  }
+  if (i == 0)
+    return;
+
+  if (TRACE > 0)
+    printf("----B: gap detected, send NAK %d-%d!\n", seq_b, (seq_b + i - 1) % SEQSPACE);
+
+  nakpkt.seqnum = seq_b;
+  nakpkt.acknum = (seq_b + i - 1) % SEQSPACE;
+  for (i = 0; i < 20; i++)
+    nakpkt.payload[i] = 'N';
+  nakpkt.checksum = ComputeChecksum(nakpkt);
+  tolayer3(B, nakpkt);
+
+  lastnak = seq_b;
+}
 
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
@@ -285,41 +354,38 @@ void B_input(struct pkt packet)
     {
 
       /*get index*/
-      if (packet.seqnum >= seqfirst)
-        index = packet.seqnum - seqfirst;
-      else
-        index = WINDOWSIZE - seqfirst + packet.seqnum;
-      /*keep receivelast */
-      receivelast = receivelast > index ? receivelast:index;
+      index = WindowIndex(packet.seqnum, seqfirst);
 
       /*if not duplicate, save to buffer*/
-
-      if (strcmp(buffer_b[index].payload, packet.payload) !=0)
+      if (buffer_b[index].acknum == NOTINUSE)
       {
         /*buffer it*/
         packet.acknum = packet.seqnum;
         buffer_b[index] = packet;
         /*if it is the base*/
         if (packet.seqnum == seqfirst){
+          /* deliver the consecutive packets from the base to the receiving application */
           for (i = 0; i < WINDOWSIZE; i++)
           {
-            if (buffer_b[i].acknum >= 0 && strcmp(buffer_b[i].payload, "")!= 0)
+            if (buffer_b[i].acknum != NOTINUSE)
+            {
+              tolayer5(B, buffer_b[i].payload);
               pckcount++;
+            }
             else
               break;
           }
           /* update state variables */
           seq_b = (seq_b + pckcount) % SEQSPACE;
-          /*update buffer*/
-          for (i = 0; i <WINDOWSIZE; i++)
-          {
-            if ((i + pckcount) <= (receivelast+1))
-              buffer_b[i] = buffer_b[i + pckcount];
-          }
-
+          lastnak = NOTINUSE;
+          /*update buffer, the slots freed at the end are empty*/
+          for (i = 0; i < WINDOWSIZE - pckcount; i++)
+            buffer_b[i] = buffer_b[i + pckcount];
+          for (; i < WINDOWSIZE; i++)
+            buffer_b[i].acknum = NOTINUSE;
         }
-        /* deliver to receiving application */
-        tolayer5(B, packet.payload);
+        else
+          SendNak(index);
       }
     }
   }
@@ -329,8 +395,12 @@ void B_input(struct pkt packet)
 void B_init(void)
 {
   /* initialise B's window, buffer and sequence number */
+  int i;
+
   seq_b = 0;   /*record the first seq num of the window*/
-  receivelast = -1;
+  lastnak = NOTINUSE;
+  for (i = 0; i < WINDOWSIZE; i++)
+    buffer_b[i].acknum = NOTINUSE;
 }
 
 /******************************************************************************